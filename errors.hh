@@ -155,6 +155,15 @@ struct LockingError : public ConcurrencyError
 };
 
 
+struct CancelledError : public ConcurrencyError
+{
+	CancelledError(const string& msg)
+	 : ConcurrencyError(msg)
+	{
+	}
+};
+
+
 struct TransactionError : public Error
 {
 	TransactionError(const string& msg)
@@ -249,6 +258,24 @@ struct UnsupportedConnectiveError : public SequentError
 };
 
 
+struct ProofCancelledError : public SequentError
+{
+	ProofCancelledError(const string& msg)
+	 : SequentError(msg)
+	{
+	}
+};
+
+
+struct ProofTimeoutError : public ProofCancelledError
+{
+	ProofTimeoutError(const string& msg)
+	 : ProofCancelledError(msg)
+	{
+	}
+};
+
+
 struct NullPointerError : public Error
 {
 	NullPointerError(const string& msg)
@@ -5,21 +5,39 @@
 #include "errors.hh"
 #include "expression.hh"
 #include "logical.hh"
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <iterator>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <string>
 #include <string_view>
 #include <vector>
 
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
 namespace Logical
 {
 
+using std::atomic;
+using std::atomic_size_t;
+using std::bad_alloc;
 using std::cout;
 using std::endl;
 using std::forward;
 using std::hex;
+using std::lock_guard;
+using std::make_move_iterator;
 using std::move;
+using std::mutex;
 using std::ostream;
+using std::pmr::memory_resource;
+using std::pmr::monotonic_buffer_resource;
+using std::string;
 using std::string_view;
 using std::vector;
 using std::optional;
@@ -31,21 +49,95 @@ class Symbol;
 class Formula;
 
 
+/*
+ * Every symbol has a tag: a dense small id in the low bits and its properties in the high ones. The predefined symbols
+ * below carry theirs from compile time, so their `predefined_id` can label `switch` cases; any other symbol gets one
+ * from `SymbolTable` on first use, the same for all symbols with the same kind and value.
+ */
 class Symbol
 {
 private:
+	// Tag assigned on first use. Copies of a symbol take over whatever was assigned so far.
+	class CachedTag
+	{
+	private:
+		mutable atomic<uint32_t> value;
+
+	public:
+		constexpr CachedTag(void)
+		 : value(0)
+		{
+		}
+
+		CachedTag(const CachedTag& cp)
+		 : value(cp.value.load(std::memory_order_relaxed))
+		{
+		}
+
+		uint32_t load(void) const
+		{
+			return value.load(std::memory_order_relaxed);
+		}
+
+		void store(uint32_t tag) const
+		{
+			value.store(tag, std::memory_order_relaxed);
+		}
+	};
+
 	string_view value;
 	bool rel, quant;
+	uint32_t predefined;
+	CachedTag assigned;
+
+	uint32_t resolve(void) const;
 
 protected:
-	constexpr Symbol(const string_view& s, bool r, bool q)
+	constexpr Symbol(const string_view& s, bool r, bool q, uint32_t t)
 	 : value(s)
 	 , rel(r)
 	 , quant(q)
+	 , predefined(t ? t | (r ? relation : 0) | (q ? quantifier : 0) : 0)
 	{
 	}
 
 public:
+	static constexpr uint32_t commutative = uint32_t(1) << 24;
+	static constexpr uint32_t idempotent = uint32_t(1) << 25;
+	static constexpr uint32_t relation = uint32_t(1) << 26;
+	static constexpr uint32_t quantifier = uint32_t(1) << 27;
+	// The symbol has a negated counterpart, whose id differs only in the lowest bit.
+	static constexpr uint32_t polarity_dual = uint32_t(1) << 28;
+
+	static constexpr uint32_t id_mask = commutative - 1;
+	static constexpr uint32_t first_user_id = 32;
+
+	uint32_t tag(void) const
+	{
+		return predefined ? predefined : resolve();
+	}
+
+	uint32_t id(void) const
+	{
+		return tag() & id_mask;
+	}
+
+	// Id of a predefined symbol known at compile time, 0 for the others.
+	constexpr uint32_t predefined_id(void) const
+	{
+		return predefined & id_mask;
+	}
+
+	bool has(uint32_t property) const
+	{
+		return tag() & property;
+	}
+
+	uint32_t dual_id(void) const
+	{
+		return has(polarity_dual) ? id() ^ 1 : 0;
+	}
+
 	template <typename... Args>
 	Formula operator()(Args&&... args) const;
 
@@ -61,7 +153,7 @@ public:
 
 	bool operator==(const Symbol& that) const
 	{
-		return this == &that || (rel == that.rel && quant == that.quant && value == that.value);
+		return this == &that || id() == that.id();
 	}
 
 	bool operator!=(const Symbol& that) const
@@ -84,8 +176,8 @@ public:
 class ConnectiveSymbol : public Symbol
 {
 public:
-	constexpr ConnectiveSymbol(const string_view& s)
-	 : Symbol(s, false, false)
+	constexpr ConnectiveSymbol(const string_view& s, uint32_t t = 0)
+	 : Symbol(s, false, false, t)
 	{
 	}
 
@@ -97,8 +189,8 @@ public:
 class QuantifierSymbol : public Symbol
 {
 public:
-	constexpr QuantifierSymbol(const string_view& s)
-	 : Symbol(s, false, true)
+	constexpr QuantifierSymbol(const string_view& s, uint32_t t = 0)
+	 : Symbol(s, false, true, t)
 	{
 	}
 
@@ -131,8 +223,8 @@ public:
 class RelationSymbol : public Symbol
 {
 public:
-	constexpr RelationSymbol(const string_view& s)
-	 : Symbol(s, true, false)
+	constexpr RelationSymbol(const string_view& s, uint32_t t = 0)
+	 : Symbol(s, true, false, t)
 	{
 	}
 
@@ -153,8 +245,158 @@ struct SymbolHash
 };
 
 
+/*
+ * Memory handed out in whole huge pages, mapped directly from the kernel with transparent huge pages requested. Meant
+ * as the upstream of an arena, which asks for a few large blocks; elsewhere than on Linux it falls back to the heap.
+ * The kernel backs only huge page aligned ranges with huge pages, so every block starts on a huge page boundary (or a
+ * stricter one if asked for).
+ */
+class HugePageResource : public memory_resource
+{
+private:
+	static constexpr size_t huge_page_size = size_t(2) << 20;
+
+	atomic_size_t mapped_bytes;
+
+	static size_t rounded(size_t bytes)
+	{
+		return (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+	}
+
+protected:
+	void* do_allocate(size_t bytes, size_t alignment) override
+	{
+#ifdef __linux__
+		// Map more than needed and unmap the unaligned head and the tail, the kernel only promises page alignment.
+		const size_t size = rounded(bytes);
+		const size_t align = alignment > huge_page_size ? alignment : huge_page_size;
+		void* const mapping = mmap(nullptr, size + align, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(mapping == MAP_FAILED)
+			throw bad_alloc();
+
+		const uintptr_t start = reinterpret_cast<uintptr_t>(mapping);
+		const uintptr_t aligned = (start + align - 1) / align * align;
+		if(aligned > start)
+			munmap(mapping, aligned - start);
+		if(start + align > aligned)
+			munmap(reinterpret_cast<void*>(aligned + size), start + align - aligned);
+
+		void* const block = reinterpret_cast<void*>(aligned);
+		madvise(block, size, MADV_HUGEPAGE);
+		mapped_bytes += size;
+		return block;
+#else
+		mapped_bytes += bytes;
+		return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+#endif
+	}
+
+	void do_deallocate(void* block, size_t bytes, [[maybe_unused]] size_t alignment) override
+	{
+#ifdef __linux__
+		munmap(block, rounded(bytes));
+		mapped_bytes -= rounded(bytes);
+#else
+		std::pmr::new_delete_resource()->deallocate(block, bytes, alignment);
+		mapped_bytes -= bytes;
+#endif
+	}
+
+	bool do_is_equal(const memory_resource& other) const noexcept override
+	{
+		return this == &other;
+	}
+
+public:
+	HugePageResource(void)
+	 : mapped_bytes(0)
+	{
+	}
+
+	size_t mapped(void) const
+	{
+		return mapped_bytes;
+	}
+
+	static constexpr size_t page_size(void)
+	{
+		return huge_page_size;
+	}
+};
+
+
+/*
+ * Region for the subformula and subexpression arrays of formulas built on a thread while a `FormulaArena::Scope` is
+ * active. The arrays are bump allocated from large blocks and only released, all at once, when the arena is destroyed,
+ * so every formula built in the arena has to be destroyed before it. Copies of such formulas are allocated on the heap
+ * as usual and may outlive the arena. An arena must only be used by one thread at a time.
+ */
+class FormulaArena
+{
+private:
+	HugePageResource huge_pages;
+	monotonic_buffer_resource blocks;
+
+	inline static thread_local memory_resource* current = nullptr;
+
+public:
+	explicit FormulaArena(bool use_huge_pages = false, size_t initial_size = size_t(1) << 16)
+	 : blocks(use_huge_pages && initial_size < HugePageResource::page_size() ? HugePageResource::page_size() : initial_size,
+	       use_huge_pages ? static_cast<memory_resource*>(&huge_pages) : std::pmr::new_delete_resource())
+	{
+	}
+
+	FormulaArena(const FormulaArena&) = delete;
+	FormulaArena& operator=(const FormulaArena&) = delete;
+
+	memory_resource* resource(void)
+	{
+		return &blocks;
+	}
+
+	// Bytes mapped in huge pages so far, 0 for an arena on the heap.
+	size_t mapped(void) const
+	{
+		return huge_pages.mapped();
+	}
+
+	// Memory for formulas built on the calling thread now, the heap unless an arena scope is active.
+	static memory_resource* current_resource(void)
+	{
+		return current ? current : std::pmr::get_default_resource();
+	}
+
+	// Formulas built by the symbols (`And(...)`, `Equal(...)`, ...) on this thread go to the arena while the scope lives.
+	class Scope
+	{
+	private:
+		memory_resource* previous;
+
+	public:
+		explicit Scope(FormulaArena& arena)
+		 : previous(current)
+		{
+			current = arena.resource();
+		}
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+		~Scope(void)
+		{
+			current = previous;
+		}
+	};
+};
+
+
 class Formula
 {
+public:
+	// Allocated from `FormulaArena::current_resource()` when built by a symbol.
+	typedef std::pmr::vector<Formula> Subformulas;
+	typedef std::pmr::vector<ExpressionReference> Subexpressions;
+
 #ifdef DEBUG
 public:
 	static mutex active_objects_mutex;
@@ -171,11 +413,75 @@ private:
 	
 	union
 	{
-		vector<Formula> formula;
-		vector<ExpressionReference> expression;
+		Subformulas formula;
+		Subexpressions expression;
 	};
 	unique_ptr<const Variable> variable;
 
+	// Computed at construction from the values of the (immutable) subformulas.
+	uint64_t structural_hash;
+	uint64_t commutative_hash;
+	size_t subtree_size;
+	size_t subtree_depth;
+
+	void summarize(void)
+	{
+		structural_hash = symbol.hash(0);
+
+		if(symbol.is_relation())
+		{
+			for(const auto& e : expression)
+				structural_hash ^= e.hash(structural_hash + 3);
+			commutative_hash = structural_hash;
+			subtree_size = expression.size();
+			subtree_depth = 1;
+			return;
+		}
+
+		subtree_size = 1;
+		subtree_depth = 0;
+		for(const auto& f : formula)
+		{
+			structural_hash ^= f.structural_hash + 0x9e3779b97f4a7c15ULL + (structural_hash << 6) + (structural_hash >> 2);
+			subtree_size += f.subtree_size;
+			if(f.subtree_depth > subtree_depth)
+				subtree_depth = f.subtree_depth;
+		}
+		subtree_depth++;
+
+		if(symbol.is_quantifier())
+			commutative_hash = structural_hash;
+		else
+			summarize_commutative();
+	}
+
+	void summarize_commutative(void)
+	{
+		static constexpr size_t inline_arity = 8;
+		uint64_t inline_hashes[inline_arity];
+		vector<uint64_t> spilled_hashes;
+		uint64_t* hashes = inline_hashes;
+		if(formula.size() > inline_arity)
+		{
+			spilled_hashes.resize(formula.size());
+			hashes = spilled_hashes.data();
+		}
+
+		size_t count = 0;
+		for(const auto& f : formula)
+			hashes[count++] = f.commutative_hash;
+
+		if(symbol.has(Symbol::commutative))
+		{
+			std::sort(hashes, hashes + count);
+			count = std::unique(hashes, hashes + count) - hashes;
+		}
+
+		commutative_hash = symbol.hash(0x2545f4914f6cdd1dULL);
+		for(size_t i = 0; i < count; i++)
+			commutative_hash ^= hashes[i] + 0x9e3779b97f4a7c15ULL + (commutative_hash << 6) + (commutative_hash >> 2);
+	}
+
 public:
 	class FormulaOrExpression
 	{
@@ -257,6 +563,10 @@ public:
 
 	Formula(const Formula& f)
 	 : symbol(f.symbol)
+	 , structural_hash(f.structural_hash)
+	 , commutative_hash(f.commutative_hash)
+	 , subtree_size(f.subtree_size)
+	 , subtree_depth(f.subtree_depth)
 	{
 		if(f.variable)
 			throw RuntimeError("Not implemented yet."); // TODO
@@ -278,6 +588,10 @@ public:
 	Formula(Formula&& f)
 	 : symbol(move(f.symbol))
 	 , variable(move(f.variable))
+	 , structural_hash(f.structural_hash)
+	 , commutative_hash(f.commutative_hash)
+	 , subtree_size(f.subtree_size)
+	 , subtree_depth(f.subtree_depth)
 	{
 		if(symbol.is_relation())
 			new(&expression) auto(move(f.expression));
@@ -299,6 +613,7 @@ public:
 	 , formula(forward<FormulaVector>(f))
 	 , variable(make_unique<typename remove_reference<VariableT>::type>(forward<VariableT>(v)))
 	{
+		summarize();
 		logical_assert(!s.is_relation());
 		logical_assert(s.is_quantifier());
 #ifdef DEBUG
@@ -312,8 +627,9 @@ public:
 
 	Formula(const Symbol& s, const vector<Formula>& f)
 	 : symbol(s)
-	 , formula(f)
+	 , formula(f.begin(), f.end())
 	{
+		summarize();
 		logical_assert(!s.is_relation());
 		logical_assert(!s.is_quantifier());
 #ifdef DEBUG
@@ -327,8 +643,9 @@ public:
 
 	Formula(const Symbol& s, vector<Formula>&& f)
 	 : symbol(s)
-	 , formula(move(f))
+	 , formula(make_move_iterator(f.begin()), make_move_iterator(f.end()))
 	{
+		summarize();
 		logical_assert(!s.is_relation());
 		logical_assert(!s.is_quantifier());
 #ifdef DEBUG
@@ -340,10 +657,27 @@ public:
 #endif
 	}
 
+	Formula(const Symbol& s, Subformulas&& f)
+	 : symbol(s)
+	 , formula(move(f))
+	{
+		summarize();
+		logical_assert(!s.is_relation());
+		logical_assert(!s.is_quantifier());
+#ifdef DEBUG
+		{
+			lock_guard<mutex> lg(active_objects_mutex);
+			//cerr << " Formula create (connective, move subformulas) " << this << endl;
+			active_objects.insert(this);
+		}
+#endif
+	}
+
 	Formula(const Symbol& s, const vector<ExpressionReference>& e)
 	 : symbol(s)
-	 , expression(e)
+	 , expression(e.begin(), e.end())
 	{
+		summarize();
 		logical_assert(s.is_relation());
 #ifdef DEBUG
 		{
@@ -356,8 +690,9 @@ public:
 
 	Formula(const Symbol& s, vector<ExpressionReference>&& e)
 	 : symbol(s)
-	 , expression(move(e))
+	 , expression(make_move_iterator(e.begin()), make_move_iterator(e.end()))
 	{
+		summarize();
 		logical_assert(s.is_relation());
 #ifdef DEBUG
 		{
@@ -368,6 +703,21 @@ public:
 #endif
 	}
 
+	Formula(const Symbol& s, Subexpressions&& e)
+	 : symbol(s)
+	 , expression(move(e))
+	{
+		summarize();
+		logical_assert(s.is_relation());
+#ifdef DEBUG
+		{
+			lock_guard<mutex> lg(active_objects_mutex);
+			//cerr << " Formula create (relation, move subexpressions) " << this << endl;
+			active_objects.insert(this);
+		}
+#endif
+	}
+
 	bool is_ground(void) const
 	{
 		if(variable)
@@ -432,20 +782,26 @@ public:
 
 	void print(ostream& out) const;
 
+	// Structural hash, a different seed gives an independent hash of the same structure.
 	uint64_t hash(uint64_t seed = 0) const
 	{
-		seed ^= symbol.hash(seed);
-		if(symbol.is_relation())
-		{
-			for(const auto& e : expression)
-				seed ^= e.hash(seed + 3);
-		}
-		else
-		{
-			for(const auto& f : formula)
-				seed ^= f.hash(seed);
-		}
-		return seed;
+		if(!seed)
+			return structural_hash;
+
+		uint64_t x = structural_hash ^ (seed * 0x9e3779b97f4a7c15ULL);
+		x ^= x >> 31;
+		x *= 0xbf58476d1ce4e5b9ULL;
+		x ^= x >> 29;
+		return x;
+	}
+
+	/*
+	 * Hash that agrees on formulas equal up to commutativity and idempotence: arguments of commutative connectives are
+	 * hashed as a set, relations and quantifiers, compared structurally, use the structural hash.
+	 */
+	uint64_t canonical_hash(void) const
+	{
+		return commutative_hash;
 	}
 
 	bool operator==(const Formula& that) const
@@ -462,7 +818,7 @@ public:
 		if(this == &that)
 			return true;
 
-		if(symbol != that.symbol)
+		if(symbol != that.symbol || subtree_size != that.subtree_size)
 			return false;
 
 		if(symbol.is_relation())
@@ -545,17 +901,7 @@ public:
 
 	size_t depth(void) const
 	{
-		if(symbol.is_relation())
-			return 1;
-
-		size_t d = 0;
-		for(const auto& f : formula)
-		{
-			const size_t nd = f.depth();
-			if(nd > d)
-				d = nd;
-		}
-		return d + 1;
+		return subtree_depth;
 	}
 
 	// template<FormulaRF> Formula operator / (FormulaRF&& d) const;
@@ -770,9 +1116,9 @@ public:
 #endif
 
 		if(symbol.is_relation())
-			expression.~vector<ExpressionReference>();
+			expression.~Subexpressions();
 		else
-			formula.~vector<Formula>();
+			formula.~Subformulas();
 	}
 };
 
@@ -816,20 +1162,32 @@ inline ostream& operator<<(ostream& stream, const Symbol& s)
 template <typename... Args>
 inline Formula ConnectiveSymbol::operator()(Args&&... args) const
 {
-	return Formula(*this, vector<Formula>({forward<Args>(args)...}));
+	Formula::Subformulas subformulas(FormulaArena::current_resource());
+	subformulas.reserve(sizeof...(Args));
+	(subformulas.emplace_back(forward<Args>(args)), ...);
+
+	return Formula(*this, move(subformulas));
 }
 
 template <typename VariableT>
 template <typename... Args>
 inline Formula QuantifierSymbol::QuantifierApplication<VariableT>::operator()(Args&&... args)
 {
-	return Formula(symbol, vector<Formula>({forward<Args>(args)...}), forward<VariableT>(variable));
+	Formula::Subformulas subformulas(FormulaArena::current_resource());
+	subformulas.reserve(sizeof...(Args));
+	(subformulas.emplace_back(forward<Args>(args)), ...);
+
+	return Formula(symbol, move(subformulas), forward<VariableT>(variable));
 }
 
 template <typename... Args>
 inline Formula RelationSymbol::operator()(Args&&... args) const
 {
-	return Formula(*this, vector<ExpressionReference>({forward<Args>(args)...}));
+	Formula::Subexpressions subexpressions(FormulaArena::current_resource());
+	subexpressions.reserve(sizeof...(Args));
+	(subexpressions.emplace_back(forward<Args>(args)), ...);
+
+	return Formula(*this, move(subexpressions));
 }
 
 inline constexpr uint64_t Symbol::hash(uint64_t seed) const
@@ -850,6 +1208,11 @@ inline void Symbol::print(ostream& out) const
 	out << value;
 }
 
+inline const string_view& Symbol::get_value(void) const
+{
+	return value;
+}
+
 inline void Formula::print(ostream& out) const
 {
 #ifdef DEBUG
@@ -884,55 +1247,45 @@ inline size_t Formula::total_size(void) const
 }*/
 #endif
 
-	size_t s = 1;
-	if(symbol.is_relation())
-	{
-		return expression.size();
-	}
-	else
-	{
-		for(const auto& f : formula)
-			s += f.total_size();
-	}
-	return s;
+	return subtree_size;
 }
 
-constexpr auto Id = ConnectiveSymbol("");
-constexpr auto Not = ConnectiveSymbol("~");
+constexpr auto Id = ConnectiveSymbol("", 2 | Symbol::polarity_dual);
+constexpr auto Not = ConnectiveSymbol("~", 3 | Symbol::polarity_dual);
 
-constexpr auto And = ConnectiveSymbol("∧");
-constexpr auto Or = ConnectiveSymbol("∨");
-constexpr auto NAnd = ConnectiveSymbol("⊼");
-constexpr auto NOr = ConnectiveSymbol("⊽");
+constexpr auto And = ConnectiveSymbol("∧", 4 | Symbol::commutative | Symbol::idempotent | Symbol::polarity_dual);
+constexpr auto Or = ConnectiveSymbol("∨", 6 | Symbol::commutative | Symbol::idempotent | Symbol::polarity_dual);
+constexpr auto NAnd = ConnectiveSymbol("⊼", 5 | Symbol::commutative | Symbol::idempotent | Symbol::polarity_dual);
+constexpr auto NOr = ConnectiveSymbol("⊽", 7 | Symbol::commutative | Symbol::idempotent | Symbol::polarity_dual);
 
-constexpr auto Xor = ConnectiveSymbol("⊻");
-constexpr auto NXor = ConnectiveSymbol("⩝");
-constexpr auto Equiv = ConnectiveSymbol("↔");
-constexpr auto NEquiv = ConnectiveSymbol("↮");
+constexpr auto Xor = ConnectiveSymbol("⊻", 8 | Symbol::commutative | Symbol::polarity_dual);
+constexpr auto NXor = ConnectiveSymbol("⩝", 9 | Symbol::commutative | Symbol::polarity_dual);
+constexpr auto Equiv = ConnectiveSymbol("↔", 10 | Symbol::commutative | Symbol::polarity_dual);
+constexpr auto NEquiv = ConnectiveSymbol("↮", 11 | Symbol::commutative | Symbol::polarity_dual);
 
-constexpr auto Impl = ConnectiveSymbol("→");
-constexpr auto NImpl = ConnectiveSymbol("↛");
-constexpr auto RImpl = ConnectiveSymbol("←");
-constexpr auto NRImpl = ConnectiveSymbol("↚");
+constexpr auto Impl = ConnectiveSymbol("→", 12 | Symbol::polarity_dual);
+constexpr auto NImpl = ConnectiveSymbol("↛", 13 | Symbol::polarity_dual);
+constexpr auto RImpl = ConnectiveSymbol("←", 14 | Symbol::polarity_dual);
+constexpr auto NRImpl = ConnectiveSymbol("↚", 15 | Symbol::polarity_dual);
 
-constexpr auto ForAll = QuantifierSymbol("∀");
-constexpr auto Exists = QuantifierSymbol("∃");
+constexpr auto ForAll = QuantifierSymbol("∀", 28);
+constexpr auto Exists = QuantifierSymbol("∃", 29);
 // constexpr auto Unique = QuantifierSymbol("∃!");
 
-constexpr auto True = ConnectiveSymbol("⊤");
-constexpr auto False = ConnectiveSymbol("⊥");
+constexpr auto True = ConnectiveSymbol("⊤", 16 | Symbol::polarity_dual);
+constexpr auto False = ConnectiveSymbol("⊥", 17 | Symbol::polarity_dual);
 
-constexpr auto Ident = RelationSymbol("≡");
-constexpr auto NIdent = RelationSymbol("≢");
-constexpr auto Equal = RelationSymbol("=");
-constexpr auto NEqual = RelationSymbol("≠");
+constexpr auto Ident = RelationSymbol("≡", 18 | Symbol::polarity_dual);
+constexpr auto NIdent = RelationSymbol("≢", 19 | Symbol::polarity_dual);
+constexpr auto Equal = RelationSymbol("=", 20 | Symbol::polarity_dual);
+constexpr auto NEqual = RelationSymbol("≠", 21 | Symbol::polarity_dual);
 
-constexpr auto Pred = RelationSymbol("≺");
-constexpr auto Succ = RelationSymbol("≻");
-constexpr auto EPred = RelationSymbol("≼");
-constexpr auto ESucc = RelationSymbol("≽");
-constexpr auto NPred = RelationSymbol("⊀");
-constexpr auto NSucc = RelationSymbol("⊁");
+constexpr auto Pred = RelationSymbol("≺", 22 | Symbol::polarity_dual);
+constexpr auto Succ = RelationSymbol("≻", 24 | Symbol::polarity_dual);
+constexpr auto EPred = RelationSymbol("≼", 26);
+constexpr auto ESucc = RelationSymbol("≽", 27);
+constexpr auto NPred = RelationSymbol("⊀", 23 | Symbol::polarity_dual);
+constexpr auto NSucc = RelationSymbol("⊁", 25 | Symbol::polarity_dual);
 
 template <typename FormulaRF>
 inline Formula Formula::operator%(FormulaRF&& that) const
@@ -975,6 +1328,72 @@ inline Formula Formula::operator^(FormulaRF&& that) const
 	return Xor(*this, forward<FormulaRF>(that));
 }
 
+/*
+ * Tags of the symbols not predefined, looked up by kind and value. The predefined symbols are registered too, so an
+ * equal symbol constructed elsewhere gets their tag.
+ */
+class SymbolTable
+{
+private:
+	mutex table_mutex;
+	unordered_map<string, uint32_t> tags;
+	uint32_t next_id;
+
+	static string key(const Symbol& symbol)
+	{
+		const char kind = symbol.is_relation() ? 'r' : (symbol.is_quantifier() ? 'q' : 'c');
+		return kind + string(symbol.get_value());
+	}
+
+public:
+	SymbolTable(void)
+	 : next_id(Symbol::first_user_id)
+	{
+		const Symbol* const predefined[] = {&Id, &Not, &And, &NAnd, &Or, &NOr, &Xor, &NXor, &Equiv, &NEquiv, &Impl, &NImpl, &RImpl,
+		    &NRImpl, &True, &False, &Ident, &NIdent, &Equal, &NEqual, &Pred, &NPred, &Succ, &NSucc, &EPred, &ESucc, &ForAll, &Exists};
+		for(const Symbol* symbol : predefined)
+			tags.emplace(key(*symbol), symbol->tag());
+	}
+
+	uint32_t find_or_add(const Symbol& symbol)
+	{
+		lock_guard<mutex> lock(table_mutex);
+
+		auto found = tags.find(key(symbol));
+		if(found != tags.end())
+			return found->second;
+
+		if(next_id > Symbol::id_mask)
+			throw RuntimeError("Too many symbols.");
+		const uint32_t tag = next_id++ | (symbol.is_relation() ? Symbol::relation : 0) | (symbol.is_quantifier() ? Symbol::quantifier : 0);
+		tags.emplace(key(symbol), tag);
+		return tag;
+	}
+
+	size_t size(void)
+	{
+		lock_guard<mutex> lock(table_mutex);
+		return tags.size();
+	}
+};
+
+inline SymbolTable& symbol_table(void)
+{
+	static SymbolTable table;
+	return table;
+}
+
+inline uint32_t Symbol::resolve(void) const
+{
+	uint32_t tag = assigned.load();
+	if(!tag)
+	{
+		tag = symbol_table().find_or_add(*this);
+		assigned.store(tag);
+	}
+	return tag;
+}
+
 /*
 
 constexpr auto Everyone = ConnectiveSymbol("◻");
@@ -1109,6 +1528,16 @@ void formula_test(void)
 	logical_assert(b != a);
 	logical_assert(b == b);
 
+	const auto a_prim = ConnectiveSymbol("a");
+	const auto and_prim = ConnectiveSymbol("∧");
+	logical_assert(a == a_prim && a.id() == a_prim.id() && a.id() >= Symbol::first_user_id && a.id() != b.id());
+	logical_assert(a != RelationSymbol("a") && !a.has(Symbol::commutative) && RelationSymbol("a").has(Symbol::relation));
+	logical_assert(and_prim == And && and_prim.has(Symbol::idempotent) && Xor.has(Symbol::commutative) && !Xor.has(Symbol::idempotent));
+	logical_assert(And.dual_id() == NAnd.id() && NImpl.dual_id() == Impl.id() && Equal.has(Symbol::relation) && ForAll.has(Symbol::quantifier));
+	logical_assert(!Exists.has(Symbol::polarity_dual) && ForAll != Exists && ForAll != QuantifierSymbol("∃!"));
+	const ConnectiveSymbol a_copy(a), and_copy(And);
+	logical_assert(a_copy == a && a_copy.id() == a.id() && and_copy == And && and_copy.predefined_id() == And.id() && a.predefined_id() == 0);
+
 	logical_assert(a() == a());
 	logical_assert(a() != b());
 	logical_assert(b() != a());
@@ -1132,6 +1561,51 @@ void formula_test(void)
 	const auto f1_prim = ForAll[x_prim](Equal(x, x_prim));
 
 	logical_assert(f1 == f1_prim);
+
+	const auto g1 = Or(a(), And(b(), a()));
+	const auto g2 = Or(a(), And(b(), a()));
+	logical_assert(g1 == g2 && g1 != Or(a(), And(a(), b())) && g1 != Or(a(), And(b(), a(), a())), "Formulas should compare by structure.");
+	const auto direct = Formula(Or, vector<Formula>({a(), And(b(), a())}));
+	logical_assert(direct == g1 && Formula(g1) == g1);
+	logical_assert(Equal(x, x) == Equal(x, x_prim) && Equal(x, x) != Equal(x, y) && Equal(x, x) != Equal(y, x));
+
+	logical_assert(g1.total_size() == 5 && g1.depth() == 3 && a().depth() == 1 && Equal(x, y).total_size() == 2 && Equal(x, y).depth() == 1);
+	logical_assert(direct.hash() == g1.hash() && Formula(g1).hash() == g1.hash());
+	logical_assert(g1.hash(7) == direct.hash(7) && g1.hash(7) != g1.hash(8) && g1.hash() != Or(a(), And(a(), b())).hash());
+	logical_assert(f1.hash() == f1_prim.hash() && f1.depth() == 2, "Hash should agree with equality.");
+	logical_assert(g1.canonical_hash() == Or(And(a(), b()), a()).canonical_hash() && And(a(), b(), a()).canonical_hash() == And(b(), a()).canonical_hash(), "Canonical hash should ignore argument order and repetition.");
+	logical_assert(Impl(a(), b()).canonical_hash() != Impl(b(), a()).canonical_hash() && f1.canonical_hash() == f1_prim.canonical_hash());
+
+	HugePageResource pages;
+	void* const page_block = pages.allocate(100, 64);
+	void* const wide_block = pages.allocate(100, 2 * HugePageResource::page_size());
+	logical_assert(reinterpret_cast<uintptr_t>(wide_block) % (2 * HugePageResource::page_size()) == 0, "Alignment asked for should be honoured.");
+#ifdef __linux__
+	logical_assert(reinterpret_cast<uintptr_t>(page_block) % HugePageResource::page_size() == 0, "Blocks should start on a huge page.");
+	logical_assert(pages.mapped() == 2 * HugePageResource::page_size(), "Only the rounded size should stay mapped.");
+#endif
+	static_cast<char*>(page_block)[99] = static_cast<char*>(wide_block)[99] = 1;
+	pages.deallocate(wide_block, 100, 2 * HugePageResource::page_size());
+	pages.deallocate(page_block, 100, 64);
+	logical_assert(pages.mapped() == 0);
+
+	FormulaArena heap_arena, huge_arena(true);
+	{
+		FormulaArena::Scope scope(heap_arena);
+		const auto h1 = Or(a(), And(b(), a()));
+		logical_assert(h1 == g1 && h1.total_size() == g1.total_size());
+		logical_assert(FormulaArena::current_resource() == heap_arena.resource() && heap_arena.mapped() == 0);
+
+		{
+			FormulaArena::Scope inner(huge_arena);
+			const auto h2 = Impl(h1, Equal(x, y));
+			const Formula h2_copy(h2);
+			logical_assert(huge_arena.mapped() >= HugePageResource::page_size() && h2_copy == h2 && static_cast<const Formula&>(h2[0]) == g1);
+		}
+
+		logical_assert(FormulaArena::current_resource() == heap_arena.resource(), "Scopes should nest.");
+	}
+	logical_assert(FormulaArena::current_resource() == std::pmr::get_default_resource());
 }
 
 } // namespace Logical
@@ -2,6 +2,8 @@
 #ifndef LOGICAL_LOGICAL_HH
 #define LOGICAL_LOGICAL_HH
 
+#include <cstddef>
+
 namespace Logical
 {
 
@@ -25,6 +27,15 @@ template <typename Collection>
 class Reorder;
 template <typename Collection>
 class Parallel;
+template <typename Item>
+class Rope;
+// Items kept without heap allocation, see `Unfold`.
+static constexpr size_t unfold_inline_items = 16;
+
+template <typename Item, size_t Inline = unfold_inline_items>
+class Unfold;
+template <typename Item>
+class SideView;
 
 class UnionFind;
 class Partition;
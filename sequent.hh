@@ -34,116 +34,297 @@ static inline Zip<CompoundFormula, CompoundFormula> ZipOfCompoundFormula(const F
 }
 
 
-class Sequent
+static inline Parallel<Shadow<CompoundFormula>> ParallelOfCompoundFormula(const Formula& formula)
+{
+	return Parallel<Shadow<CompoundFormula>>(ShadowOfCompoundFormula(formula));
+}
+
+
+/*
+ * Order in which `Sequent` explores branches and compares formulas, lower weights first. No single order is best for
+ * every sequent, see `prove_portfolio`.
+ */
+class Guide
 {
+public:
+	enum Kind
+	{
+		SizeAscending,
+		SizeDescending,
+		Depth,
+		Random
+	};
+
 private:
-	class UnionFind;
+	Kind kind;
+	uint64_t seed;
+
+	// Maps a hash to [0, 1).
+	static float random_weight(uint64_t x)
+	{
+		x ^= x >> 30;
+		x *= 0xbf58476d1ce4e5b9ULL;
+		x ^= x >> 27;
+		x *= 0x94d049bb133111ebULL;
+		x ^= x >> 31;
+		return float(x >> 40) / float(uint64_t(1) << 24);
+	}
+
+	float weight(const Formula& formula) const
+	{
+		switch(kind)
+		{
+		case SizeDescending:
+			return -float(formula.total_size());
+
+		case Depth:
+			return formula.depth();
+
+		case Random:
+			return random_weight(formula.hash(seed));
+
+		default:
+			return formula.total_size();
+		}
+	}
+
+public:
+	Guide(Kind k = SizeAscending, uint64_t s = 0)
+	 : kind(k)
+	 , seed(s)
+	{
+	}
+
+	Kind get_kind(void) const
+	{
+		return kind;
+	}
+
+	float positive(const Formula& formula) const
+	{
+		return weight(formula);
+	}
 
+	float negative(const Formula& formula) const
+	{
+		return weight(formula);
+	}
+
+	float equal(const Formula& first, const Formula& second) const
+	{
+		if(kind == Random)
+			return random_weight(first.hash(seed) ^ second.hash(seed + 1));
+
+		// Pairs of small formulas of similar size (or depth) are the likeliest to be equal.
+		const float w1 = (kind == Depth) ? first.depth() : first.total_size();
+		const float w2 = (kind == Depth) ? second.depth() : second.total_size();
+		const float w = (w1 + w2) * (1.0f + fabs(w1 - w2));
+		return (kind == SizeDescending) ? -w : w;
+	}
+
+	// Size ascending, size descending, depth and random with the seed provided.
+	static vector<Guide> portfolio(uint64_t seed = 0)
+	{
+		return vector<Guide>({Guide(SizeAscending), Guide(SizeDescending), Guide(Depth), Guide(Random, seed)});
+	}
+};
+
+
+class Sequent
+{
+public:
+	// Cache of formula equality. Entries are keyed by address, so a cache may be shared by sequents proven at the same
+	// time as long as all their formulas stay alive.
+	class UnionFind : public CompareCache<Formula>
+	{
+	};
+
+private:
 	UnionFind* unionfind;
-	bool toplevel;
+	unique_ptr<UnionFind> own_unionfind;
+	ExecutionContext* context;
+	const void* task;
+	Guide guide;
 	Unfold<Formula> left;
 	Unfold<Formula> right;
+	float left_work;
+	float right_work;
+
+	// Branches of a sequent with less estimated work are explored on the calling thread instead of being forked.
+	static constexpr float sequential_cutoff = 24;
+
+	// Sides of every shape built by `breakdown` go through `SideView`, so this is instantiated only once. The work of
+	// the sides is given by the parent, see `derived_work`.
+	Sequent(const SideView<Formula>& l, const SideView<Formula>& r, UnionFind* uf, ExecutionContext* ctx, const Guide& g, float lw, float rw)
+	 : unionfind(uf)
+	 , context(ctx)
+	 , task(nullptr)
+	 , guide(g)
+	 , left(l)
+	 , right(r)
+	 , left_work(lw)
+	 , right_work(rw)
+	{
+#ifdef DEBUG
+		logical_assert(fabs(left_work - estimate_work(left)) < 0.5f && fabs(right_work - estimate_work(right)) < 0.5f, "Derived work should match the sides.");
+#endif
+	}
 
-	template<typename LeftInitializer, typename RightInitializer>
-	Sequent(LeftInitializer&& l, RightInitializer&& r, UnionFind* uf)
-	 : left(forward<LeftInitializer>(l))
-	 , right(forward<RightInitializer>(r))
-	 , unionfind(uf)
-	 , toplevel(false)
+	static float estimate_work(const Unfold<Formula>& side)
 	{
+		const auto size = [](const Formula& f) -> float { return f.total_size(); };
+		const auto plus = [](float one, float two) { return one + two; };
+		return side.map_reduce(size, plus, 0.0f);
+	}
+
+	/*
+	 * Work of a side built by `breakdown` from the work of the side of this sequent it starts with (a copy of it, or
+	 * the side without the formula `removed`), plus the formulas added after it. Only the added formulas are visited,
+	 * so deriving the estimate does not depend on the size of the sides.
+	 */
+	float derived_work(const SideView<Formula>& side, const Formula& removed) const
+	{
+		const Unfold<Formula>* const leading = side.leading_unfold();
+		float w = 0;
+
+		if(leading && leading->same_storage(left))
+			w = left_work;
+		else if(leading && leading->same_storage(right))
+			w = right_work;
+		else if(leading)
+		{
+			// `breakdown` looks for the formula on the left first.
+			const bool on_left = left.count(removed);
+			w = (on_left ? left_work : right_work) - removed.total_size() * (on_left ? left : right).count(removed);
+		}
+
+		side.for_each([&w](const Formula& f) { w += f.total_size(); }, leading ? leading->size() : 0);
+		return w;
+	}
+
+	float branch_cost(void) const
+	{
+		return left_work + right_work;
+	}
+
+	static float pair_cost(const Formula& first, const Formula& second)
+	{
+		return first.total_size() + second.total_size();
 	}
 
 protected:
 	float guide_positive(const Formula& formula)
 	{
-		return formula.total_size();
+		return guide.positive(formula);
 	}
 
 	float guide_negative(const Formula& formula)
 	{
-		return formula.total_size();
+		return guide.negative(formula);
 	}
 
 	float guide_equal(const Formula& first, const Formula& second)
 	{
-		return (first.total_size() + second.total_size()) * (1.0f + fabs(float(first.total_size()) - float(second.total_size())));
+		return guide.equal(first, second);
 	}
 
 private:
-	template <typename LeftInitializer, typename RightInitializer>
-	static bool sub_prove(LeftInitializer&& l, RightInitializer&& r, UnionFind* uf)
+	// In deterministic mode a cache is only used by the task that proves the sequent owning it.
+	bool owns_cache(void) const
 	{
-		return Sequent(forward<LeftInitializer>(l), forward<RightInitializer>(r), uf).prove();
+		return !context->deterministic() || ExecutionContext::task() == task;
+	}
+
+	// Proves the sequent built by `breakdown` from this one by breaking down the formula `removed`.
+	bool sub_prove(const SideView<Formula>& l, const SideView<Formula>& r, UnionFind* uf, const Formula& removed) const
+	{
+		const float lw = derived_work(l, removed);
+		const float rw = derived_work(r, removed);
+
+		if(uf && !owns_cache())
+		{
+			UnionFind task_cache;
+			return Sequent(l, r, &task_cache, context, guide, lw, rw).prove();
+		}
+
+		return Sequent(l, r, uf, context, guide, lw, rw).prove();
 	}
 
 	bool breakdown(const Formula& formula)
 	{
 		//cerr << "breakdown: " << formula << endl;
 
+		// A sibling branch already decided the result, or the search was cancelled. No answer is given either way.
+		if(CancellationToken::current_cancelled())
+			throw CancelledError("Branch of the proof cancelled.");
+		if(context->has_error())
+			throw ConcurrencyError("Proof stopped by an error of the execution context.");
+
 		if(left.count(formula))
 		{
-			const auto singleton_formula = Singleton<Formula>(formula);
-			const auto left_sans_formula = left - singleton_formula;
+			const auto left_sans_formula = Unfold<Formula>(left, formula);
 
 			logical_assert(left.count(formula));
 			logical_assert(!left_sans_formula.count(formula));
 			logical_assert(left_sans_formula.size() == left.size() - 1);
 			logical_assert(Unfold<Formula>(left_sans_formula).size() == left_sans_formula.size());
 
-			switch(formula.get_symbol())
+			switch(formula.get_symbol().id())
 			{
-			case True:
-				return sub_prove(left_sans_formula, right, unionfind);
+			case True.predefined_id():
+				return sub_prove(left_sans_formula, right, unionfind, formula);
 
-			case False:
+			case False.predefined_id():
 				return true;
 
-			case Not:
-				return sub_prove(left_sans_formula, right + Singleton<Formula>(formula[0]), unionfind);
+			case Not.predefined_id():
+				return sub_prove(left_sans_formula, right + Singleton<Formula>(formula[0]), unionfind, formula);
 
-			case RImpl:
-				return ShadowOfCompoundFormula(formula).for_any([this, &left_sans_formula, &formula](auto& subformula) {
+			case RImpl.predefined_id():
+				return ParallelOfCompoundFormula(formula).for_any([this, &left_sans_formula, &formula](auto& subformula) {
 					if(&subformula == &formula[0])
-						return sub_prove(left_sans_formula + Singleton<Formula>(formula[0]), right, unionfind);
+						return sub_prove(left_sans_formula + Singleton<Formula>(formula[0]), right, unionfind, formula);
 					else if(&subformula == &formula[1])
-						return sub_prove(left_sans_formula, right + Singleton<Formula>(formula[1]), unionfind);
+						return sub_prove(left_sans_formula, right + Singleton<Formula>(formula[1]), unionfind, formula);
 					else
 						throw RuntimeError("None of the implication subformulas identical to the formula provided.");
-				});
+				}, [this](const Formula&) { return branch_cost(); }, sequential_cutoff);
 
-			case Impl:
-				return ShadowOfCompoundFormula(formula).for_any([this, &left_sans_formula, &formula](auto& subformula) {
+			case Impl.predefined_id():
+				return ParallelOfCompoundFormula(formula).for_any([this, &left_sans_formula, &formula](auto& subformula) {
 					if(&subformula == &formula[1])
-						return sub_prove(left_sans_formula + Singleton<Formula>(formula[1]), right, unionfind);
+						return sub_prove(left_sans_formula + Singleton<Formula>(formula[1]), right, unionfind, formula);
 					else if(&subformula == &formula[0])
-						return sub_prove(left_sans_formula, right + Singleton<Formula>(formula[0]), unionfind);
+						return sub_prove(left_sans_formula, right + Singleton<Formula>(formula[0]), unionfind, formula);
 					else
 						throw RuntimeError("None of the implication subformulas identical to the formula provided.");
-				});
+				}, [this](const Formula&) { return branch_cost(); }, sequential_cutoff);
 
-			case NRImpl:
-				return sub_prove(left_sans_formula + Singleton<Formula>(formula[0]), right + Singleton<Formula>(formula[1]), unionfind);
+			case NRImpl.predefined_id():
+				return sub_prove(left_sans_formula + Singleton<Formula>(formula[0]), right + Singleton<Formula>(formula[1]), unionfind, formula);
 
-			case NImpl:
-				return sub_prove(left_sans_formula + Singleton<Formula>(formula[1]), right + Singleton<Formula>(formula[0]), unionfind);
+			case NImpl.predefined_id():
+				return sub_prove(left_sans_formula + Singleton<Formula>(formula[1]), right + Singleton<Formula>(formula[0]), unionfind, formula);
 
-			case And:
-				return sub_prove(left_sans_formula + ShadowOfCompoundFormula(formula), right, unionfind);
+			case And.predefined_id():
+				return sub_prove(left_sans_formula + ShadowOfCompoundFormula(formula), right, unionfind, formula);
 
-			case Or:
+			case Or.predefined_id():
 				return ShadowOfCompoundFormula(formula)
 				    .sort([this](const Formula& f) { return guide_negative(f); })
 				    .for_all([this, &left_sans_formula, &formula](
-				                 auto& subformula) { return sub_prove(left_sans_formula + Singleton<Formula>(subformula), right, unionfind); });
+				                 auto& subformula) { return sub_prove(left_sans_formula + Singleton<Formula>(subformula), right, unionfind, formula); },
+				        [this](const Formula&) { return branch_cost(); }, sequential_cutoff);
 
-			case NOr:
-				return sub_prove(left_sans_formula, right + ShadowOfCompoundFormula(formula), unionfind);
+			case NOr.predefined_id():
+				return sub_prove(left_sans_formula, right + ShadowOfCompoundFormula(formula), unionfind, formula);
 
-			case NAnd:
+			case NAnd.predefined_id():
 				return ShadowOfCompoundFormula(formula)
 				    .sort([this](const Formula& f) { return guide_positive(f); })
 				    .for_all([this, &left_sans_formula, &formula](
-				                 auto& subformula) { return sub_prove(left_sans_formula, right + Singleton<Formula>(subformula), unionfind); });
+				                 auto& subformula) { return sub_prove(left_sans_formula, right + Singleton<Formula>(subformula), unionfind, formula); },
+				        [this](const Formula&) { return branch_cost(); }, sequential_cutoff);
 
 			default:
 				return false;
@@ -155,63 +336,64 @@ private:
 
 		if(right.count(formula))
 		{
-			const auto singleton_formula = Singleton<Formula>(formula);
-			const auto right_sans_formula = right - singleton_formula;
+			const auto right_sans_formula = Unfold<Formula>(right, formula);
 
-			switch(formula.get_symbol())
+			switch(formula.get_symbol().id())
 			{
-			case False:
-				return sub_prove(left, right_sans_formula, unionfind);
+			case False.predefined_id():
+				return sub_prove(left, right_sans_formula, unionfind, formula);
 
-			case True:
+			case True.predefined_id():
 				return true;
 
-			case Not:
-				return sub_prove(left + Singleton<Formula>(formula[0]), right_sans_formula, unionfind);
+			case Not.predefined_id():
+				return sub_prove(left + Singleton<Formula>(formula[0]), right_sans_formula, unionfind, formula);
 
-			case NRImpl:
-				return ShadowOfCompoundFormula(formula).for_any([this, &right_sans_formula, &formula](auto& subformula) {
+			case NRImpl.predefined_id():
+				return ParallelOfCompoundFormula(formula).for_any([this, &right_sans_formula, &formula](auto& subformula) {
 					if(&subformula == &formula[0])
-						return sub_prove(right_sans_formula + Singleton<Formula>(formula[0]), right, unionfind);
+						return sub_prove(right_sans_formula + Singleton<Formula>(formula[0]), right, unionfind, formula);
 					else if(&subformula == &formula[1])
-						return sub_prove(right_sans_formula, right + Singleton<Formula>(formula[1]), unionfind);
+						return sub_prove(right_sans_formula, right + Singleton<Formula>(formula[1]), unionfind, formula);
 					else
 						throw RuntimeError("None of the implication subformulas identical to the formula provided.");
-				});
+				}, [this](const Formula&) { return branch_cost(); }, sequential_cutoff);
 
-			case NImpl:
-				return ShadowOfCompoundFormula(formula).for_any([this, &right_sans_formula, &formula](auto& subformula) {
+			case NImpl.predefined_id():
+				return ParallelOfCompoundFormula(formula).for_any([this, &right_sans_formula, &formula](auto& subformula) {
 					if(&subformula == &formula[1])
-						return sub_prove(right_sans_formula + Singleton<Formula>(formula[1]), right, unionfind);
+						return sub_prove(right_sans_formula + Singleton<Formula>(formula[1]), right, unionfind, formula);
 					else if(&subformula == &formula[0])
-						return sub_prove(right_sans_formula, right + Singleton<Formula>(formula[0]), unionfind);
+						return sub_prove(right_sans_formula, right + Singleton<Formula>(formula[0]), unionfind, formula);
 					else
 						throw RuntimeError("None of the implication subformulas identical to the formula provided.");
-				});
+				}, [this](const Formula&) { return branch_cost(); }, sequential_cutoff);
 
-			case Impl:
-				return sub_prove(left + Singleton<Formula>(formula[0]), right_sans_formula + Singleton<Formula>(formula[1]), unionfind);
+			case Impl.predefined_id():
+				return sub_prove(left + Singleton<Formula>(formula[0]), right_sans_formula + Singleton<Formula>(formula[1]), unionfind, formula);
 
-			case RImpl:
-				return sub_prove(left + Singleton<Formula>(formula[1]), right_sans_formula + Singleton<Formula>(formula[0]), unionfind);
+			case RImpl.predefined_id():
+				return sub_prove(left + Singleton<Formula>(formula[1]), right_sans_formula + Singleton<Formula>(formula[0]), unionfind, formula);
 
-			case Or:
-				return sub_prove(left, right_sans_formula + ShadowOfCompoundFormula(formula), unionfind);
+			case Or.predefined_id():
+				return sub_prove(left, right_sans_formula + ShadowOfCompoundFormula(formula), unionfind, formula);
 
-			case And:
+			case And.predefined_id():
 				return ShadowOfCompoundFormula(formula)
 				    .sort([this](const Formula& f) { return guide_positive(f); })
 				    .for_all([this, &right_sans_formula, &formula](
-				                 auto& subformula) { return sub_prove(left, right_sans_formula + Singleton<Formula>(subformula), unionfind); });
+				                 auto& subformula) { return sub_prove(left, right_sans_formula + Singleton<Formula>(subformula), unionfind, formula); },
+				        [this](const Formula&) { return branch_cost(); }, sequential_cutoff);
 
-			case NAnd:
-				return sub_prove(left + ShadowOfCompoundFormula(formula), right_sans_formula, unionfind);
+			case NAnd.predefined_id():
+				return sub_prove(left + ShadowOfCompoundFormula(formula), right_sans_formula, unionfind, formula);
 
-			case NOr:
+			case NOr.predefined_id():
 				return ShadowOfCompoundFormula(formula)
 				    .sort([this](const Formula& f) { return guide_negative(f); })
 				    .for_all([this, &right_sans_formula, &formula](
-				                 auto& subformula) { return sub_prove(left + Singleton<Formula>(subformula), right_sans_formula, unionfind); });
+				                 auto& subformula) { return sub_prove(left + Singleton<Formula>(subformula), right_sans_formula, unionfind, formula); },
+				        [this](const Formula&) { return branch_cost(); }, sequential_cutoff);
 
 			default:
 				return false;
@@ -224,20 +406,76 @@ private:
 		throw RuntimeError("Formula not found on left nor right side of the sequent.");
 	}
 
+	/*
+	 * Identity axiom: some formula occurs on both sides. Both sides are sorted by `Formula::canonical_hash`, which
+	 * agrees on formulas `equal` may identify, and merged, so only formulas with the same hash are ever compared.
+	 */
+	bool axiom(void)
+	{
+		if(left.size() == 0 || right.size() == 0)
+			return false;
+
+		typedef pair<uint64_t, const Formula*> hashed_formula;
+
+		const auto hashed_side = [](const Unfold<Formula>& side) {
+			vector<hashed_formula> hashed;
+			hashed.reserve(side.size());
+			for(const Formula& formula : side)
+				hashed.push_back(hashed_formula(formula.canonical_hash(), addressof(formula)));
+			std::sort(hashed.begin(), hashed.end(), [](const hashed_formula& one, const hashed_formula& two) { return one.first < two.first; });
+			return hashed;
+		};
+
+		const auto hashed_left = hashed_side(left);
+		const auto hashed_right = hashed_side(right);
+
+		size_t l = 0, r = 0;
+		while(l < hashed_left.size() && r < hashed_right.size())
+		{
+			const uint64_t h = hashed_left[l].first;
+
+			if(h < hashed_right[r].first)
+				l++;
+			else if(hashed_right[r].first < h)
+				r++;
+			else
+			{
+				size_t l_end = l, r_end = r;
+				while(l_end < hashed_left.size() && hashed_left[l_end].first == h)
+					l_end++;
+				while(r_end < hashed_right.size() && hashed_right[r_end].first == h)
+					r_end++;
+
+				for(size_t i = l; i < l_end; i++)
+					for(size_t j = r; j < r_end; j++)
+						if(equal(*hashed_left[i].second, *hashed_right[j].second))
+							return true;
+
+				l = l_end;
+				r = r_end;
+			}
+		}
+
+		return false;
+	}
+
 	bool equal(const Formula& first, const Formula& second)
 	{
 		//cerr << "equal: " << first << " == " << second << endl;
-		if(unionfind)
-			return unionfind->equal(first, second);
+		if(unionfind && owns_cache())
+		{
+			bool hit = false;
+			const bool result = unionfind->equal(first, second, &hit);
+			if(hit)
+				context->work().cache_hits++;
+			return result;
+		}
 		else
 			return formulas_equal(first, second);
 	}
 
 	bool formulas_equal(const Formula& first, const Formula& second)
 	{
-		static const auto commutative_symbols = unordered_set<Symbol, SymbolHash>({And, Or, NAnd, NOr, Xor, NXor, Equiv, NEquiv});
-		static const auto idempotent_symbols = unordered_set<Symbol, SymbolHash>({And, Or, NAnd, NOr});
-
 		const auto& first_symbol = first.get_symbol();
 		const auto& second_symbol = second.get_symbol();
 
@@ -245,9 +483,9 @@ private:
 			return false;
 		else if(first == second)
 			return true;
-		else if(commutative_symbols.count(first_symbol))
+		else if(first_symbol.has(Symbol::commutative))
 		{
-			if(!idempotent_symbols.count(first_symbol) && first.size() != second.size())
+			if(!first_symbol.has(Symbol::idempotent) && first.size() != second.size())
 				return false;
 
 			const bool first_in_second = ShadowOfCompoundFormula(first).for_all([this, &second](const auto& sub1)
@@ -255,7 +493,8 @@ private:
 				auto& parent = *this;
 				return ShadowOfCompoundFormula(second)
 				    .sort([&parent, &sub1](const auto& sub2) { return parent.guide_equal(sub1, sub2); })
-				    .for_any([&parent, &sub1](const auto& sub2) { return parent.equal(sub1, sub2); });
+				    .for_any([&parent, &sub1](const auto& sub2) { return parent.equal(sub1, sub2); },
+				        [&sub1](const auto& sub2) { return pair_cost(sub1, sub2); }, sequential_cutoff);
 			});
 
 			const bool second_in_first = ShadowOfCompoundFormula(second).for_all([this, &first](const auto& sub2)
@@ -263,7 +502,8 @@ private:
 				auto& parent = *this;
 				return ShadowOfCompoundFormula(first)
 				    .sort([&parent, &sub2](const auto& sub1) { return parent.guide_equal(sub2, sub1); })
-				    .for_any([&parent, &sub2](const auto& sub1) { return parent.equal(sub2, sub1); });
+				    .for_any([&parent, &sub2](const auto& sub1) { return parent.equal(sub2, sub1); },
+				        [&sub2](const auto& sub1) { return pair_cost(sub2, sub1); }, sequential_cutoff);
 			});
 
 			return first_in_second && second_in_first;
@@ -275,7 +515,8 @@ private:
 
 			return ZipOfCompoundFormula(first, second)
 			    .sort([this](const auto& p) { return -guide_equal(p.first, p.second); })
-			    .for_all([this](const auto& p) { return equal(p.first, p.second); });
+			    .for_all([this](const auto& p) { return equal(p.first, p.second); },
+			        [](const auto& p) { return pair_cost(p.first, p.second); }, sequential_cutoff);
 		}
 		else if(!first_symbol.is_relation() && first_symbol.is_quantifier())
 		{
@@ -291,52 +532,54 @@ private:
 		}
 	}
 
-	class UnionFind : public CompareCache<Formula>
+public:
+	template<typename LeftInitializer, typename RightInitializer>
+	Sequent(LeftInitializer&& l, RightInitializer&& r, ExecutionContext& ctx, bool usecache=true)
+	 : own_unionfind(usecache ? new UnionFind() : nullptr)
+	 , context(&ctx)
+	 , task(nullptr)
+	 , left(forward<LeftInitializer>(l))
+	 , right(forward<RightInitializer>(r))
 	{
-	private:
-		Sequent& sequent;
-
-	protected:
-		bool value_compare(const Formula& one, const Formula& two)
-		{
-			return sequent.formulas_equal(one, two);
-		}
-
-	public:
-		UnionFind(Sequent& s)
-		 : sequent(s)
-		{
-		}
-	};
+		unionfind = own_unionfind.get();
+		left_work = estimate_work(left);
+		right_work = estimate_work(right);
+	}
 
-public:
+	// Uses the cache provided instead of a private one.
 	template<typename LeftInitializer, typename RightInitializer>
-	Sequent(LeftInitializer&& l, RightInitializer&& r, bool usecache=true)
-	 : left(forward<LeftInitializer>(l))
+	Sequent(LeftInitializer&& l, RightInitializer&& r, ExecutionContext& ctx, UnionFind& cache, const Guide& g = Guide())
+	 : unionfind(&cache)
+	 , context(&ctx)
+	 , task(nullptr)
+	 , guide(g)
+	 , left(forward<LeftInitializer>(l))
 	 , right(forward<RightInitializer>(r))
-	 , unionfind(usecache ? new UnionFind(*this) : nullptr)
-	 , toplevel(true)
 	{
+		left_work = estimate_work(left);
+		right_work = estimate_work(right);
 	}
-	
-	~Sequent(void)
+
+	template<typename LeftInitializer, typename RightInitializer>
+	Sequent(LeftInitializer&& l, RightInitializer&& r, bool usecache=true)
+	 : Sequent(forward<LeftInitializer>(l), forward<RightInitializer>(r), ExecutionContext::current(), usecache)
 	{
-		if(unionfind && toplevel)
-			delete unionfind;
 	}
 	
 	bool prove(void)
 	{
 		//cerr << "prove " << (&left) << ", " << (&right) << endl;
 		//cerr << left << " |- " << right << endl;
-		
+
+		ExecutionContext::Scope scope(*context);
+		task = ExecutionContext::task();
+		context->work().nodes++;
+
 		return (left.size() == 0 && right.size() == 0)
-		    || (left * right)
-		           .sort([this](const pair<const Formula&, const Formula&>& p) { return guide_equal(p.first, p.second); })
-		           .for_any([this](const pair<const Formula&, const Formula&>& p) { return equal(p.first, p.second); })
+		    || axiom()
 		    || (left + right)
 		           .sort([this](const Formula& f) { return (left.count(f) ? guide_negative(f) : 0) + (right.count(f) ? guide_positive(f) : 0); })
-		           .for_any([this](const Formula& f) { return breakdown(f); });
+		           .for_any([this](const Formula& f) { return breakdown(f); }, [this](const Formula&) { return branch_cost(); }, sequential_cutoff);
 	}
 };
 
@@ -346,6 +589,248 @@ inline bool prove(const initializer_list<Formula>& l, const initializer_list<For
 	return Sequent(l, r).prove();
 }
 
+
+inline bool prove(const initializer_list<Formula>& l, const initializer_list<Formula>& r, ExecutionContext& context)
+{
+	return Sequent(l, r, context).prove();
+}
+
+
+/*
+ * Handle of a proof running in the background on the worker pool. The proof owns copies of its formulas and its own
+ * execution context, so statistics can be read while it runs. A proof that is cancelled or runs past its deadline stops
+ * at the next branch. Dropping the handle cancels the proof. Not to be waited for from within tasks of the pool.
+ */
+class Proof
+{
+public:
+	enum class Status
+	{
+		Running,
+		Proved,
+		Refuted,
+		Cancelled,
+		TimedOut,
+		Failed
+	};
+
+private:
+	struct State
+	{
+		const vector<Formula> left;
+		const vector<Formula> right;
+		ExecutionContext context;
+		CancellationToken token;
+		Latch done;
+		atomic<Status> status;
+		const chrono_steady_clock::time_point started;
+		atomic<chrono_steady_clock::duration::rep> elapsed;
+
+		State(vector<Formula>&& l, vector<Formula>&& r, chrono_steady_clock::time_point deadline, size_t max_threads)
+		 : left(move(l))
+		 , right(move(r))
+		 , context(max_threads)
+		 , token(nullptr, deadline)
+		 , done(1)
+		 , status(Status::Running)
+		 , started(chrono_steady_clock::now())
+		 , elapsed(0)
+		{
+		}
+
+		void run(void)
+		{
+			Status result;
+
+			try
+			{
+				CancellationToken::Scope scope(token);
+				const bool proved = Sequent(left, right, context).prove();
+
+				// Only a search the token never interrupted is trusted. One that ran to the end is definite even if the
+				// deadline passed meanwhile; one cut short before it was decided throws `CancelledError`.
+				if(!token.interrupted())
+					result = proved ? Status::Proved : Status::Refuted;
+				else if(token.is_expired())
+					result = Status::TimedOut;
+				else
+					result = Status::Cancelled;
+			}
+			catch(const CancelledError& error)
+			{
+				result = token.is_expired() ? Status::TimedOut : Status::Cancelled;
+			}
+			catch(...)
+			{
+				done.fail(current_exception());
+				result = Status::Failed;
+			}
+
+			elapsed = (chrono_steady_clock::now() - started).count();
+			status = result;
+			done.count_down();
+		}
+	};
+
+	shared_ptr<State> state;
+
+public:
+	Proof(vector<Formula>&& left, vector<Formula>&& right, chrono_steady_clock::time_point deadline, size_t max_threads)
+	 : state(make_shared<State>(move(left), move(right), deadline, max_threads))
+	{
+		worker_pool().submit([s = state](void) { s->run(); });
+	}
+
+	Proof(const Proof&) = delete;
+	Proof& operator=(const Proof&) = delete;
+	Proof(Proof&&) = default;
+	Proof& operator=(Proof&&) = default;
+
+	~Proof(void)
+	{
+		if(state)
+			cancel();
+	}
+
+	void cancel(void)
+	{
+		state->token.cancel();
+		worker_pool().notify();
+	}
+
+	bool ready(void) const
+	{
+		return state->done.ready();
+	}
+
+	void wait(void) const
+	{
+		state->done.wait();
+	}
+
+	template <typename Rep, typename Period>
+	bool wait_for(const chrono_duration<Rep, Period>& timeout_duration) const
+	{
+		return state->done.wait_for(timeout_duration);
+	}
+
+	Status status(void) const
+	{
+		return state->status;
+	}
+
+	// Partial while the proof is running.
+	ExecutionContext::Statistics statistics(void) const
+	{
+		return state->context.statistics();
+	}
+
+	chrono_steady_clock::duration elapsed(void) const
+	{
+		if(ready())
+			return chrono_steady_clock::duration(state->elapsed);
+		else
+			return chrono_steady_clock::now() - state->started;
+	}
+
+	// Waits for the result. Throws if the proof failed, was cancelled or timed out.
+	bool get(void) const
+	{
+		wait();
+
+		switch(status())
+		{
+		case Status::Proved:
+			return true;
+
+		case Status::Refuted:
+			return false;
+
+		case Status::Cancelled:
+			throw ProofCancelledError("Proof cancelled.");
+
+		case Status::TimedOut:
+			throw ProofTimeoutError("Proof deadline passed.");
+
+		default:
+			rethrow_exception(state->done.error());
+		}
+	}
+};
+
+
+inline Proof prove_async(vector<Formula> l, vector<Formula> r, chrono_steady_clock::time_point deadline = chrono_steady_clock::time_point::max(), size_t max_threads = max_thread_count)
+{
+	return Proof(move(l), move(r), deadline, max_threads);
+}
+
+
+/*
+ * Proves many sequents on the worker pool with one formula equality cache shared by the whole batch, or one cache per
+ * sequent in deterministic mode. Elements of the collection are pairs of the left and the right side. Results are
+ * returned in the order of the collection; `on_result` receives each of them as soon as it is known, called from the
+ * thread that proved the sequent.
+ */
+template <typename Collection, typename OnResult>
+vector<bool> prove_batch(const Collection& sequents, ExecutionContext& context, const OnResult& on_result)
+{
+	Sequent::UnionFind cache;
+	vector<char> results(sequents.size(), false);
+	vector<size_t> indices(sequents.size());
+	for(size_t i = 0; i < indices.size(); i++)
+		indices[i] = i;
+
+	const auto batch = Parallel<Shadow<vector<size_t>>>(Shadow<vector<size_t>>(indices), context);
+	batch.for_all([&](size_t index) {
+		// In deterministic mode the work of a sequent must not depend on the progress of the others.
+		Sequent::UnionFind own_cache;
+		Sequent::UnionFind& sequent_cache = context.deterministic() ? own_cache : cache;
+
+		const auto& sequent = sequents[index];
+		results[index] = Sequent(sequent.first, sequent.second, context, sequent_cache).prove();
+		on_result(index, bool(results[index]));
+		return true;
+	});
+
+	return vector<bool>(results.begin(), results.end());
+}
+
+
+template <typename Collection>
+vector<bool> prove_batch(const Collection& sequents, ExecutionContext& context = ExecutionContext::current())
+{
+	return prove_batch(sequents, context, [](size_t, bool) {});
+}
+
+
+/*
+ * Races several guides on the same sequent with one shared equality cache. Every complete search is definitive, so the
+ * first strategy to finish decides the result, proved or refuted, and cancels the others.
+ */
+inline bool prove_portfolio(const vector<Formula>& left, const vector<Formula>& right, const vector<Guide>& guides = Guide::portfolio(), ExecutionContext& context = ExecutionContext::current())
+{
+	Sequent::UnionFind shared_cache;
+	atomic_int answer(-1);
+
+	Parallel<Shadow<vector<Guide>>>(Shadow<vector<Guide>>(guides), context).for_any([&](const Guide& guide) {
+		// In deterministic mode the work of a strategy must not depend on the progress of the others.
+		Sequent::UnionFind own_cache;
+		Sequent::UnionFind& cache = context.deterministic() ? own_cache : shared_cache;
+
+		// A strategy stopped by the winner throws, so every result returned is definite.
+		answer = Sequent(left, right, context, cache, guide).prove();
+		return true;
+	});
+
+	return answer == 1;
+}
+
+// Portfolio of the default strategies, with the random ones seeded from the context.
+inline bool prove_portfolio(const vector<Formula>& left, const vector<Formula>& right, ExecutionContext& context)
+{
+	return prove_portfolio(left, right, Guide::portfolio(context.seed()), context);
+}
+
 } // namespace Logical
 
 #ifdef DEBUG
@@ -397,6 +882,144 @@ void sequent_test(void)
 
 		logical_assert(prove({Equal(x, x)}, {Equal(x, x)}));
 		//logical_assert(!prove({Equal(x, x)}, {Equal(y, y)}));
+
+		ExecutionContext narrow(1), wide(4);
+		bool narrow_result = false, wide_result = false;
+		thread narrow_prover([&]() { narrow_result = prove({Impl(a(), b()), Impl(b(), c())}, {Impl(a(), c())}, narrow); });
+		thread wide_prover([&]() { wide_result = prove({Impl(a(), b()), Impl(a(), c())}, {Impl(a(), And(b(), c()))}, wide); });
+		narrow_prover.join();
+		wide_prover.join();
+		logical_assert(narrow_result && wide_result, "Provers with separate contexts should succeed.");
+		logical_assert(narrow.statistics().peak_thread_count <= 1, "Prover exceeded the thread budget of its context.");
+		logical_assert(narrow.thread_count() == 0 && wide.thread_count() == 0, "Threads left in the context after the proof.");
+
+		// Nested loops waiting for slots on top of each other used to stall with a tight budget.
+		vector<Formula> nested_left;
+		for(size_t i = 0; i < 4; i++)
+			nested_left.push_back(Or(a(), Or(b(), Impl(c(), a()))));
+		for(size_t budget = 1; budget <= 2; budget++)
+		{
+			ExecutionContext tight(budget);
+			logical_assert(!Sequent(nested_left, vector<Formula>({a()}), tight).prove(), "Sequent should fail.");
+			logical_assert(tight.statistics().peak_thread_count <= budget, "Prover exceeded the thread budget of its context.");
+			logical_assert(tight.thread_count() == 0, "Threads left in the context after the proof.");
+		}
+
+		const auto async1 = prove_async({a(), Impl(a(), b())}, {b()});
+		logical_assert(async1.wait_for(chrono_milliseconds(60000)), "Asynchronous proof did not finish.");
+		logical_assert(async1.get() && async1.status() == Proof::Status::Proved, "Asynchronous proof should succeed.");
+		logical_assert(!prove_async({Or(a(), b())}, {b()}).get(), "Asynchronous proof should fail.");
+
+		const auto async2 = prove_async({Impl(a(), b()), Impl(b(), c())}, {Impl(a(), c())}, chrono_steady_clock::now());
+		async2.wait();
+		logical_assert(async2.status() == Proof::Status::TimedOut, "Proof past its deadline should time out.");
+		try
+		{
+			async2.get();
+			logical_assert(false, "Result of a timed out proof should throw.");
+		}
+		catch(const ProofTimeoutError& error)
+		{
+		}
+
+		CancellationToken expired(nullptr, chrono_steady_clock::now());
+		logical_assert(expired.is_expired() && !expired.interrupted(), "Deadline alone should not count as an interruption.");
+		CancellationToken child(&expired);
+		logical_assert(child.is_cancelled() && expired.interrupted() && !child.interrupted(), "Check should mark the token that cancelled it.");
+
+		auto async3 = prove_async({Impl(a(), b()), Impl(a(), c())}, {Impl(a(), And(b(), c()))});
+		async3.cancel();
+		async3.wait();
+		logical_assert(async3.status() == Proof::Status::Proved || async3.status() == Proof::Status::Cancelled, "Cancelled proof should not be refuted.");
+
+		// Refutable, and long enough for the deadlines to cut it short at different points.
+		vector<Formula> refutable_left;
+		for(size_t i = 0; i < 4; i++)
+			refutable_left.push_back(Or(a(), Or(b(), Impl(c(), a()))));
+		for(int delay = 0; delay <= 20; delay += 2)
+		{
+			auto async4 = prove_async(refutable_left, {a()}, chrono_steady_clock::now() + chrono_milliseconds(delay));
+			if(delay % 4)
+				async4.cancel();
+			async4.wait();
+			const auto status = async4.status();
+			logical_assert(status == Proof::Status::Refuted || status == Proof::Status::TimedOut || status == Proof::Status::Cancelled, "Interrupted proof of a refutable sequent should not succeed.");
+			logical_assert(status != Proof::Status::Cancelled || delay % 4, "Proof not cancelled should not report cancellation.");
+		}
+
+		const auto batch1 = vector<pair<vector<Formula>, vector<Formula>>>({
+		    {{a(), Impl(a(), b())}, {b()}},
+		    {{Or(a(), b())}, {b()}},
+		    {{Impl(a(), b()), Impl(b(), c())}, {Impl(a(), c())}},
+		    {{Impl(a(), b())}, {Impl(b(), a())}},
+		    {{}, {Or(a(), Not(a()))}}});
+		const auto batch_expected = vector<bool>({true, false, true, false, true});
+		atomic_size_t batch_reported(0);
+		const auto batch2 = prove_batch(batch1, ExecutionContext::current(), [&](size_t index, bool result) {
+			logical_assert(index < batch1.size() && result == batch_expected[index], "Wrong result reported by batch proof.");
+			batch_reported++;
+		});
+		logical_assert(batch2 == batch_expected, "Wrong results of batch proof.");
+		logical_assert(batch_reported == batch1.size(), "Every result of the batch should be reported.");
+		logical_assert(prove_batch(vector<pair<vector<Formula>, vector<Formula>>>()).empty());
+
+		for(const auto& guide : Guide::portfolio(7))
+		{
+			Sequent::UnionFind guide_cache;
+			auto& ctx = ExecutionContext::current();
+			logical_assert(Sequent(vector<Formula>({Impl(a(), b()), Impl(a(), c())}), vector<Formula>({Impl(a(), And(b(), c()))}), ctx, guide_cache, guide).prove(), "Sequent should succeed with every guide.");
+			logical_assert(!Sequent(vector<Formula>({Impl(a(), b())}), vector<Formula>({Impl(b(), a())}), ctx, guide_cache, guide).prove(), "Sequent should fail with every guide.");
+		}
+		logical_assert(prove_portfolio({Impl(a(), b()), Impl(b(), c())}, {Impl(a(), c())}), "Portfolio proof should succeed.");
+		logical_assert(!prove_portfolio({Or(a(), b())}, {b()}, Guide::portfolio(3)), "Portfolio proof should fail.");
+		logical_assert(prove_portfolio({}, {Or(a(), Not(a()))}, {Guide(Guide::Random, 11)}), "Portfolio proof should succeed.");
+
+		vector<Formula> wide_left, wide_right;
+		for(size_t i = 0; i < 200; i++)
+		{
+			wide_left.push_back(And(a(), Impl(b(), c())));
+			wide_right.push_back(Or(c(), Impl(a(), b())));
+		}
+		wide_right.push_back(And(Impl(b(), c()), a()));
+		logical_assert(Sequent(wide_left, wide_right, ExecutionContext::current(), false).prove(), "Axiom should be found up to commutativity.");
+		logical_assert(Sequent(wide_left, wide_left).prove(), "Axiom should be found among equal formulas.");
+
+		ExecutionContext::Statistics reference_run;
+		for(size_t run = 0; run < 3; run++)
+		{
+			ExecutionContext reproducible(4);
+			reproducible.set_deterministic(true, 5);
+			logical_assert(prove({Impl(a(), b()), Impl(b(), c()), Impl(c(), a())}, {And(Impl(a(), c()), Impl(c(), b()))}, reproducible), "Deterministic proof should succeed.");
+			logical_assert(!prove({Impl(a(), b()), Or(b(), c())}, {And(a(), Impl(c(), a()))}, reproducible), "Deterministic proof should fail.");
+			logical_assert(prove_portfolio({Impl(a(), b()), Impl(b(), c())}, {Impl(a(), c())}, reproducible), "Deterministic portfolio proof should succeed.");
+			logical_assert(prove_batch(batch1, reproducible) == prove_batch(batch1), "Deterministic batch should give the same results.");
+
+			const auto statistics = reproducible.statistics();
+			logical_assert(statistics.nodes > 0);
+			if(run == 0)
+				reference_run = statistics;
+			else
+				logical_assert(statistics.nodes == reference_run.nodes && statistics.cache_hits == reference_run.cache_hits
+				                   && statistics.forked == reference_run.forked && statistics.inlined == reference_run.inlined,
+				    "Deterministic runs should do the same work.");
+		}
+
+		ExecutionContext failed;
+		failed.set_error();
+		try
+		{
+			prove({a()}, {Or(b(), a())}, failed);
+			logical_assert(false, "Prover with the error flag set should not proceed.");
+		}
+		catch(const CancelledError& error)
+		{
+			logical_assert(false, "Prover with the error flag set should report the error, not a cancellation.");
+		}
+		catch(const ConcurrencyError& error)
+		{
+		}
+		logical_assert(!ExecutionContext::default_context().has_error(), "Error flag of one context should not affect the others.");
+		logical_assert(prove({a()}, {Or(b(), a())}), "Sequent should succeed.");
 	}
 	catch(const UnsupportedConnectiveError& error)
 	{
@@ -3,12 +3,19 @@
 #ifndef LOGICAL_SYNC_HH
 #define LOGICAL_SYNC_HH
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <exception>
 #include <functional>
 #include <initializer_list>
+#include <memory>
 #include <mutex>
+#include <thread>
 #include <utility>
+#include <vector>
 
 #include "errors.hh"
 #include "logical.hh"
@@ -18,20 +25,28 @@ namespace Logical
 
 using std::adopt_lock_t;
 using std::atomic_bool;
+using std::atomic_size_t;
 using std::condition_variable;
 using std::current_exception;
 using std::defer_lock_t;
+using std::deque;
 using std::exception_ptr;
+using std::find;
 using std::forward;
+using std::function;
 using std::initializer_list;
+using std::lock_guard;
+using std::make_shared;
 using std::move;
 using std::mutex;
 using std::pair;
 using std::reference_wrapper;
 using std::rethrow_exception;
+using std::shared_ptr;
 using std::thread;
 using std::try_to_lock_t;
 using std::unique_lock;
+using std::unique_ptr;
 using std::vector;
 
 template <typename A, typename B>
@@ -40,37 +55,134 @@ using chrono_duration = std::chrono::duration<A, B>;
 template <typename A, typename B>
 using chrono_time_point = std::chrono::time_point<A, B>;
 
+using chrono_steady_clock = std::chrono::steady_clock;
+
 template <typename key, typename value>
 using unordered_map_sane = std::unordered_map<key, value>;
 
 template <typename key>
 using unordered_set_sane = std::unordered_set<key>;
 
-class Thread : public thread
+/*
+ * Countdown of the tasks in one batch with a slot for the first error. Only the last completion (or the first error)
+ * wakes the waiters, and every batch has its own latch, so joining unrelated batches never contends. The counter is
+ * guarded by the mutex, so the latch may be destroyed as soon as a waiter saw it ready.
+ */
+class Latch
 {
 private:
-	static mutex finished_access;
-	static condition_variable finished;
+	size_t pending;
+	atomic_bool failed;
+	mutable mutex access;
+	condition_variable done;
+	exception_ptr first_error;
+
+public:
+	explicit Latch(size_t count = 0)
+	 : pending(count)
+	 , failed(false)
+	 , first_error(nullptr)
+	{
+	}
+
+	Latch(const Latch&) = delete;
+	Latch& operator=(const Latch&) = delete;
+
+	void add(size_t count = 1)
+	{
+		lock_guard<mutex> lock(access);
+		pending += count;
+	}
+
+	// Returns true for the last completion.
+	bool count_down(void)
+	{
+		lock_guard<mutex> lock(access);
+		logical_assert(pending > 0);
+		if(--pending)
+			return false;
+		done.notify_all();
+		return true;
+	}
+
+	// Keep the first error only, the rest are consequences of it more often than not.
+	void fail(exception_ptr error)
+	{
+		lock_guard<mutex> lock(access);
+		if(first_error)
+			return;
+		first_error = error;
+		failed = true;
+		done.notify_all();
+	}
+
+	bool ready(void) const
+	{
+		lock_guard<mutex> lock(access);
+		return !pending;
+	}
+
+	bool has_error(void) const
+	{
+		return failed;
+	}
+
+	exception_ptr error(void) const
+	{
+		lock_guard<mutex> lock(access);
+		return first_error;
+	}
+
+	void wait(void)
+	{
+		unique_lock<mutex> lock(access);
+		done.wait(lock, [this](void) { return !pending; });
+	}
+
+	// Returns true if the latch got ready in time.
+	template <typename Rep, typename Period>
+	bool wait_for(const chrono_duration<Rep, Period>& timeout_duration)
+	{
+		unique_lock<mutex> lock(access);
+		return done.wait_for(lock, timeout_duration, [this](void) { return !pending; });
+	}
+
+	// Returns as soon as all tasks finished or one of them failed.
+	void wait_or_fail(void)
+	{
+		unique_lock<mutex> lock(access);
+		done.wait(lock, [this](void) { return !pending || failed; });
+	}
+};
 
+
+class Thread : public thread
+{
+private:
+	// Shared with the running task, so that a detached thread may outlive its `Thread` object.
 	struct Extension
 	{
+		mutex access;
 		exception_ptr error;
 		atomic_bool running;
+		Latch* latch;
 
 		Extension(bool r)
 		 : error(nullptr)
 		 , running(r)
+		 , latch(nullptr)
 		{
 		}
 	};
 
-	Extension* extension;
+	shared_ptr<Extension> extension;
 
 public:
 	exception_ptr error(void) const
 	{
 		if(!extension)
 			return nullptr;
+		lock_guard<mutex> lock(extension->access);
 		return extension->error;
 	}
 
@@ -83,9 +195,11 @@ public:
 
 private:
 	template <typename Fn, typename... Args>
-	static void task(Extension* extension, Fn&& fn, Args&&... args)
+	static void task(shared_ptr<Extension> extension, Fn&& fn, Args&&... args)
 	{
-		logical_assert(extension, "Extension pointer invalid");
+		logical_assert(extension != nullptr, "Extension pointer invalid");
+
+		exception_ptr error = nullptr;
 
 		try
 		{
@@ -93,17 +207,49 @@ private:
 		}
 		catch(...)
 		{
-			unique_lock<mutex> lock(finished_access);
-			extension->error = current_exception();
+			error = current_exception();
 		}
 
+		lock_guard<mutex> lock(extension->access);
+		extension->error = error;
+		extension->running = false;
+		if(extension->latch)
 		{
-			unique_lock<mutex> lock(finished_access);
-			extension->running = false;
-			finished.notify_all();
+			if(error)
+				extension->latch->fail(error);
+			extension->latch->count_down();
 		}
 	}
 
+	// Count the thread in the latch of `finalize`, or count it down right away if it already finished.
+	void attach(Latch& latch)
+	{
+		if(!extension)
+		{
+			latch.count_down();
+			return;
+		}
+
+		lock_guard<mutex> lock(extension->access);
+		if(extension->running)
+		{
+			extension->latch = &latch;
+			return;
+		}
+		if(extension->error)
+			latch.fail(extension->error);
+		latch.count_down();
+	}
+
+	void detach_latch(void)
+	{
+		if(!extension)
+			return;
+
+		lock_guard<mutex> lock(extension->access);
+		extension->latch = nullptr;
+	}
+
 public:
 	Thread(void) noexcept
 	{
@@ -112,24 +258,22 @@ public:
 	template <typename Fn, typename... Args>
 	explicit Thread(Fn&& fn, Args&&... args)
 	{
-		extension = new Extension(true);
+		extension = make_shared<Extension>(true);
 		thread::operator=(thread(task<Fn, Args...>, extension, fn, args...));
 	}
 
 	Thread(const Thread&) = delete;
 
 	Thread(Thread&& other) noexcept
-	 : extension(other.extension)
-	 , thread(static_cast<thread&&>(other))
+	 : thread(static_cast<thread&&>(other))
+	 , extension(move(other.extension))
 	{
-		other.extension = nullptr;
 	}
 
 	Thread& operator=(Thread&& rhs) noexcept
 	{
 		thread::operator=(static_cast<thread&&>(rhs));
-		extension = rhs.extension;
-		rhs.extension = nullptr;
+		extension = move(rhs.extension);
 		return *this;
 	}
 
@@ -150,40 +294,17 @@ public:
 	template <typename Collection>
 	static void finalize(Collection& all_threads)
 	{
-		bool running = true;
-		exception_ptr error = nullptr;
-
-		while(running)
-		{
-			unique_lock<mutex> lock(finished_access);
-
-			running = false;
+		Latch latch(all_threads.size());
 
-			for(Thread& thr : all_threads)
-			{
-				if(thr.running())
-					running = true;
-				if(thr.error())
-				{
-					error = thr.error();
-					break;
-				}
-			}
+		for(Thread& thr : all_threads)
+			thr.attach(latch);
 
-			if(running)
-				finished.wait(lock);
-		}
+		latch.wait_or_fail();
 
 		for(Thread& thr : all_threads)
-		{
-			logical_assert(!thr.running(), "Thread should not be running.");
+			thr.detach_latch();
 
-			if(thr.error())
-			{
-				error = thr.error();
-				break;
-			}
-		}
+		const exception_ptr error = latch.error();
 
 		if(!error)
 		{
@@ -202,21 +323,541 @@ public:
 
 	static void finalize(initializer_list<reference_wrapper<Thread>>&& all_threads)
 	{
-		finalize(move(all_threads));
+		finalize(all_threads);
+	}
+
+};
+
+/*
+ * Cooperative cancellation. Tokens form a tree: a token counts as cancelled when it or any of its ancestors has been
+ * cancelled. The token of the task being executed is kept in a thread-local variable, so nested parallel loops started
+ * by the task pick it up as their parent without passing it around explicitly.
+ */
+class CancellationToken
+{
+private:
+	const CancellationToken* parent;
+	atomic_bool cancelled;
+	mutable atomic_bool observed;
+	const bool has_deadline;
+	const chrono_steady_clock::time_point deadline;
+
+	inline static thread_local const CancellationToken* current_token = nullptr;
+
+public:
+	explicit CancellationToken(const CancellationToken* p = nullptr)
+	 : parent(p)
+	 , cancelled(false)
+	 , observed(false)
+	 , has_deadline(false)
+	 , deadline()
+	{
+	}
+
+	// The token counts as cancelled once the deadline passes.
+	CancellationToken(const CancellationToken* p, chrono_steady_clock::time_point d)
+	 : parent(p)
+	 , cancelled(false)
+	 , observed(false)
+	 , has_deadline(true)
+	 , deadline(d)
+	{
+	}
+
+	CancellationToken(const CancellationToken&) = delete;
+	CancellationToken& operator=(const CancellationToken&) = delete;
+
+	void cancel(void)
+	{
+		cancelled.store(true, std::memory_order_release);
+	}
+
+	bool is_expired(void) const
+	{
+		return has_deadline && chrono_steady_clock::now() >= deadline;
+	}
+
+	// The token in the chain that is found cancelled remembers it, so the owner can tell later whether any task stopped
+	// early because of it.
+	bool is_cancelled(void) const
+	{
+		for(const CancellationToken* token = this; token; token = token->parent)
+			if(token->cancelled.load(std::memory_order_acquire) || token->is_expired())
+			{
+				token->observed.store(true, std::memory_order_release);
+				return true;
+			}
+		return false;
+	}
+
+	// True if some check found this token cancelled. A deadline that passes after the last check interrupts nothing.
+	bool interrupted(void) const
+	{
+		return observed.load(std::memory_order_acquire);
+	}
+
+	static const CancellationToken* current(void)
+	{
+		return current_token;
+	}
+
+	// True if the task running on this thread has been cancelled and its result is going to be discarded.
+	static bool current_cancelled(void)
+	{
+		return current_token && current_token->is_cancelled();
+	}
+
+	class Scope
+	{
+	private:
+		const CancellationToken* previous;
+
+	public:
+		explicit Scope(const CancellationToken& token)
+		 : previous(current_token)
+		{
+			current_token = &token;
+		}
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+		~Scope(void)
+		{
+			current_token = previous;
+		}
+	};
+};
+
+/*
+ * Counting semaphore that hands a released permit directly to the oldest waiter, so newcomers can not overtake the
+ * queue and a release wakes exactly the thread it was meant for. Waiting is left to the caller: it queues a `Ticket` and
+ * keeps doing useful work until the ticket is granted; `release` reports whether the caller has to wake the waiters.
+ * While the waiting thread is busy with other work its ticket is set aside and skipped, a permit handed to it would
+ * stay unused until that work finishes. Tickets of threads returning to work they had started are served before the
+ * tickets for new work. A budget of 0 means unlimited permits.
+ */
+class HandoffSemaphore
+{
+public:
+	class Ticket
+	{
+	private:
+		friend class HandoffSemaphore;
+		atomic_bool granted;
+		bool queued;
+		bool returning;
+		bool aside;
+
+	public:
+		Ticket(void)
+		 : granted(false)
+		 , queued(false)
+		 , returning(false)
+		 , aside(false)
+		{
+		}
+
+		Ticket(const Ticket&) = delete;
+		Ticket& operator=(const Ticket&) = delete;
+
+		bool is_granted(void) const
+		{
+			return granted.load(std::memory_order_acquire);
+		}
+	};
+
+private:
+	const size_t budget;
+	atomic_size_t in_use;
+	mutex access;
+	deque<Ticket*> returning;
+	deque<Ticket*> waiting;
+	size_t ready_count;
+
+	bool available(void) const
+	{
+		return !budget || in_use < budget;
+	}
+
+	deque<Ticket*>& line_of(const Ticket& ticket)
+	{
+		return ticket.returning ? returning : waiting;
+	}
+
+	// With the lock held.
+	bool grant_first(deque<Ticket*>& line)
+	{
+		for(auto it = line.begin(); it != line.end(); ++it)
+		{
+			Ticket* ticket = *it;
+			if(ticket->aside)
+				continue;
+
+			line.erase(it);
+			ticket->queued = false;
+			ready_count--;
+			in_use++;
+			ticket->granted.store(true, std::memory_order_release);
+			return true;
+		}
+		return false;
+	}
+
+	// With the lock held.
+	bool hand_over(void)
+	{
+		if(!ready_count || !available())
+			return false;
+		return grant_first(returning) || grant_first(waiting);
+	}
+
+public:
+	explicit HandoffSemaphore(size_t permits = 0, size_t taken = 0)
+	 : budget(permits)
+	 , in_use(taken)
+	 , ready_count(0)
+	{
+	}
+
+	HandoffSemaphore(const HandoffSemaphore&) = delete;
+	HandoffSemaphore& operator=(const HandoffSemaphore&) = delete;
+
+	size_t permits(void) const
+	{
+		return budget;
+	}
+
+	size_t count(void) const
+	{
+		return in_use;
+	}
+
+	bool try_acquire(void)
+	{
+		lock_guard<mutex> lock(access);
+		if(ready_count || !available())
+			return false;
+		in_use++;
+		return true;
+	}
+
+	// Take a permit even if it exceeds the budget, for a thread that already runs and only comes back from waiting.
+	size_t force_acquire(void)
+	{
+		return ++in_use;
+	}
+
+	// Returns true if the ticket was granted right away. A returning ticket goes ahead of all tickets for new work.
+	bool enqueue(Ticket& ticket, bool is_returning = false)
+	{
+		lock_guard<mutex> lock(access);
+		ticket.returning = is_returning;
+		if(!ready_count && available())
+		{
+			in_use++;
+			ticket.granted.store(true, std::memory_order_release);
+			return true;
+		}
+		ticket.queued = true;
+		ready_count++;
+		line_of(ticket).push_back(&ticket);
+		return false;
 	}
 
-	~Thread(void)
+	// Leave the queue without a permit. If the ticket got granted meanwhile, the permit is passed on; returns true if another waiter got it.
+	bool withdraw(Ticket& ticket)
 	{
-		if(extension)
-			delete extension;
+		lock_guard<mutex> lock(access);
+		if(ticket.queued)
+		{
+			deque<Ticket*>& line = line_of(ticket);
+			line.erase(find(line.begin(), line.end(), &ticket));
+			ticket.queued = false;
+			if(!ticket.aside)
+				ready_count--;
+			ticket.aside = false;
+			return false;
+		}
+		if(!ticket.is_granted())
+			return false;
+		ticket.granted = false;
+		in_use--;
+		return hand_over();
+	}
+
+	/*
+	 * The waiting thread turns to other work: the ticket keeps its place in the queue but is skipped until `step_back`.
+	 * A permit granted meanwhile is passed on and the ticket queued again at the head of its line; returns true if
+	 * another waiter got the permit.
+	 */
+	bool step_aside(Ticket& ticket)
+	{
+		lock_guard<mutex> lock(access);
+		if(ticket.queued)
+		{
+			ticket.aside = true;
+			ready_count--;
+			return false;
+		}
+		if(!ticket.is_granted())
+			return false;
+
+		ticket.granted = false;
+		ticket.queued = true;
+		ticket.aside = true;
+		line_of(ticket).push_front(&ticket);
+		in_use--;
+		return hand_over();
+	}
+
+	// The waiting thread is back, the ticket may be granted right away. Returns true if a permit was handed over.
+	bool step_back(Ticket& ticket)
+	{
+		lock_guard<mutex> lock(access);
+		if(!ticket.aside)
+			return false;
+		ticket.aside = false;
+		ready_count++;
+		return hand_over();
+	}
+
+	// Returns true if the permit went to a waiter that has to be woken up.
+	bool release(void)
+	{
+		lock_guard<mutex> lock(access);
+		in_use--;
+		return hand_over();
 	}
 };
 
-#ifndef LOGICAL_SYNC_HH_thread_static_vars
-#define LOGICAL_SYNC_HH_thread_static_vars
-mutex Thread::finished_access;
-condition_variable Thread::finished;
-#endif
+/*
+ * Persistent pool of worker threads with one task deque per worker. The owner pushes and pops at the back of its deque,
+ * idle workers steal from the front of the others. Threads that are not workers (the main thread) submit to a shared
+ * injection queue. A thread waiting for its tasks to finish (`help_until`) executes queued tasks meanwhile, so nested
+ * parallel loops never block a worker while there is work left. Those tasks run on the stack of the waiting thread, on
+ * top of the wait; past `max_helping_depth` nested waits the thread stops taking tasks and only waits.
+ */
+class WorkerPool
+{
+public:
+	typedef function<void(void)> Task;
+
+private:
+	struct Worker
+	{
+		WorkerPool* pool;
+		mutex access;
+		deque<Task> tasks;
+		thread handle;
+
+		Worker(WorkerPool* p)
+		 : pool(p)
+		{
+		}
+	};
+
+	vector<unique_ptr<Worker>> workers;
+	mutex injected_access;
+	deque<Task> injected;
+	atomic_size_t queued;
+	atomic_size_t steal_from;
+	mutex idle_access;
+	condition_variable idle;
+	bool stopping;
+
+	inline static thread_local Worker* current_worker = nullptr;
+	inline static thread_local size_t helping_depth = 0;
+
+	Worker* own_worker(void) const
+	{
+		if(current_worker && current_worker->pool == this)
+			return current_worker;
+		else
+			return nullptr;
+	}
+
+	bool take(Task& task)
+	{
+		Worker* own = own_worker();
+
+		if(own)
+		{
+			lock_guard<mutex> lock(own->access);
+			if(!own->tasks.empty())
+			{
+				task = move(own->tasks.back());
+				own->tasks.pop_back();
+				return true;
+			}
+		}
+
+		{
+			lock_guard<mutex> lock(injected_access);
+			if(!injected.empty())
+			{
+				task = move(injected.front());
+				injected.pop_front();
+				return true;
+			}
+		}
+
+		const size_t start = steal_from++;
+		for(size_t i = 0; i < workers.size(); i++)
+		{
+			Worker* victim = workers[(start + i) % workers.size()].get();
+			if(victim == own)
+				continue;
+
+			lock_guard<mutex> lock(victim->access);
+			if(!victim->tasks.empty())
+			{
+				task = move(victim->tasks.front());
+				victim->tasks.pop_front();
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void work(Worker* worker)
+	{
+		current_worker = worker;
+
+		while(true)
+		{
+			if(run_one())
+				continue;
+
+			unique_lock<mutex> lock(idle_access);
+			idle.wait(lock, [this](void) { return queued || stopping; });
+			if(stopping && !queued)
+				break;
+		}
+
+		current_worker = nullptr;
+	}
+
+public:
+	explicit WorkerPool(size_t worker_count)
+	 : queued(0)
+	 , steal_from(0)
+	 , stopping(false)
+	{
+		if(!worker_count)
+			worker_count = 1;
+
+		workers.reserve(worker_count);
+		for(size_t i = 0; i < worker_count; i++)
+			workers.push_back(unique_ptr<Worker>(new Worker(this)));
+
+		for(auto& worker : workers)
+			worker->handle = thread(&WorkerPool::work, this, worker.get());
+	}
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	size_t size(void) const
+	{
+		return workers.size();
+	}
+
+	// Tasks must not throw; errors are to be captured by the task itself.
+	void submit(Task&& task)
+	{
+		Worker* own = own_worker();
+
+		queued++;
+
+		if(own)
+		{
+			lock_guard<mutex> lock(own->access);
+			own->tasks.push_back(move(task));
+		}
+		else
+		{
+			lock_guard<mutex> lock(injected_access);
+			injected.push_back(move(task));
+		}
+
+		{
+			lock_guard<mutex> lock(idle_access);
+		}
+		idle.notify_one();
+	}
+
+	bool run_one(void)
+	{
+		Task task;
+		if(!take(task))
+			return false;
+
+		queued--;
+		task();
+		return true;
+	}
+
+	// Wake up threads blocked in `help_until` after the condition they wait for became true.
+	void notify(void)
+	{
+		{
+			lock_guard<mutex> lock(idle_access);
+		}
+		idle.notify_all();
+	}
+
+	// Tasks executed within tasks executed while waiting, and so on; bounds the stack the waits take.
+	static constexpr size_t max_helping_depth = 24;
+
+	// A thread this deep in nested waits takes no more tasks, it must not start waiting for tasks of its own.
+	static bool helping_too_deep(void)
+	{
+		return helping_depth >= max_helping_depth;
+	}
+
+	// Tasks taken while waiting are executed by `run`, which receives the task to call.
+	template <typename Done, typename Run>
+	void help_until(const Done& done, const Run& run)
+	{
+		while(!done())
+		{
+			Task task;
+			const bool helping = !helping_too_deep();
+			if(helping && take(task))
+			{
+				queued--;
+				helping_depth++;
+				run(task);
+				helping_depth--;
+				continue;
+			}
+
+			unique_lock<mutex> lock(idle_access);
+			idle.wait(lock, [this, &done, helping](void) { return done() || (helping && queued) || stopping; });
+		}
+	}
+
+	template <typename Done>
+	void help_until(const Done& done)
+	{
+		help_until(done, [](Task& task) { task(); });
+	}
+
+	~WorkerPool(void)
+	{
+		{
+			lock_guard<mutex> lock(idle_access);
+			stopping = true;
+		}
+		idle.notify_all();
+
+		for(auto& worker : workers)
+			if(worker->handle.joinable())
+				worker->handle.join();
+	}
+};
 
 template <typename SharedMutex>
 class ReadLockable
@@ -819,6 +1460,7 @@ public:
 namespace Logical
 {
 
+using std::make_exception_ptr;
 using std::none_of;
 using std::shared_mutex;
 using std::unordered_map;
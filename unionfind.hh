@@ -173,7 +173,8 @@ private:
 	}
 
 public:
-	bool equal(const Value& one, const Value& two)
+	// `hit` is set when the answer comes from the cache rather than from comparing the values.
+	bool equal(const Value& one, const Value& two, bool* hit = nullptr)
 	{
 		ReadLockable equal_mutex_rl(equal_mutex);
 		size_t failures = 0;
@@ -186,11 +187,12 @@ public:
 				if(failures >= max_unlocked_equal_failures)
 					lock.upgrade();
 
-				if(&one == &two)
-					return true;
-
-				if(find(one, two))
+				if(&one == &two || find(one, two))
+				{
+					if(hit)
+						*hit = true;
 					return true;
+				}
 
 				if(partition(one, two))
 					return false;